@@ -35,7 +35,7 @@ pmemkv is a local/embedded key-value datastore optimized for persistent memory.
 For more information, see https://pmem.io/pmemkv.
 """
 
-from pmemkv.pmemkv import Database
+from pmemkv.pmemkv import Database, Change
 from _pmemkv import (
     Error,
     UnknownError,
@@ -46,4 +46,5 @@ from _pmemkv import (
     StoppedByCallback,
     WrongEngineName,
     TransactionScopeError,
+    ChangesLost,
 )
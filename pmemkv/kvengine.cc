@@ -33,62 +33,162 @@
 
 #include <Python.h>
 #include "structmember.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <new>
 #include <string>
+#include <unistd.h>
+#include <vector>
 #include <libpmemkv.h>
 #include <libpmemkv_json_config.h>
 #include <iostream>
-#include <unordered_map>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
-static PyObject *PmemkvException;
-
 typedef struct {
-	PyObject *exception;
+	int status;
+	PyObject **builtin;
 	const char *object_name;
 	const char *exception_name;
 	const char *docstring;
-} Exception;
-
-static std::unordered_map<int, Exception> ExceptionDispatcher = {
-	{PMEMKV_STATUS_UNKNOWN_ERROR,
-	 Exception{NULL, "UnknownError", "pmemkv_NI.UnknownError",
-		   "Something unexpected happened"}},
-	{PMEMKV_STATUS_NOT_FOUND,
-	 Exception{PyExc_KeyError, NULL, NULL,
-		   "Database entry or config item not found"}},
-	{PMEMKV_STATUS_NOT_SUPPORTED,
-	 Exception{NULL, "NotSupported", "pmemkv_NI.NotSupported",
-		   "Function is not implemented by current engine"}},
-	{PMEMKV_STATUS_INVALID_ARGUMENT,
-	 Exception{NULL, "InvalidArgument", "pmemkv_NI.InvalidArgument",
-		   "Argument to function has wrong value"}},
-	{PMEMKV_STATUS_CONFIG_PARSING_ERROR,
-	 Exception{NULL, "ConfigParsingError", "pmemkv_NI.ConfigParsingError",
-		   "Processing config failed"}},
-	{PMEMKV_STATUS_CONFIG_TYPE_ERROR,
-	 Exception{NULL, "ConfigTypeError", "pmemkv_NI.ConfigTypeError",
-		   "Config item has different type than expected"}},
-	{PMEMKV_STATUS_STOPPED_BY_CB,
-	 Exception{NULL, "StoppedByCallback", "pmemkv_NI.StoppedByCallback",
-		   "Callback function aborted in an unexpected way"}},
-	{PMEMKV_STATUS_OUT_OF_MEMORY,
-	 Exception{
-		 PyExc_MemoryError, NULL, NULL,
-		 "Operation failed because there is not enough memory (or space on the device)"}},
-	{PMEMKV_STATUS_WRONG_ENGINE_NAME,
-	 Exception{NULL, "WrongEngineName", "pmemkv_NI.WrongEngineName",
-		   "Engine name does not match any available engine"}},
-	{PMEMKV_STATUS_TRANSACTION_SCOPE_ERROR,
-	 Exception{
-		 NULL, "TransactionScopeError", "pmemkv_NI.TransactionScopeError",
-		 "An error with the scope of the libpmemobj transaction. This exception is defined for compatibility with pmemkv API and probably will never occur"}},
+} ExceptionDescriptor;
+
+/*
+ * Mapping of pmemkv statuses to Python exceptions. Statuses without builtin
+ * exception get their own class (derived from Error), created separately in
+ * every interpreter importing the module.
+ */
+static const ExceptionDescriptor ExceptionDescriptors[] = {
+	{PMEMKV_STATUS_UNKNOWN_ERROR, NULL, "UnknownError", "pmemkv_NI.UnknownError",
+	 "Something unexpected happened"},
+	{PMEMKV_STATUS_NOT_FOUND, &PyExc_KeyError, NULL, NULL,
+	 "Database entry or config item not found"},
+	{PMEMKV_STATUS_NOT_SUPPORTED, NULL, "NotSupported", "pmemkv_NI.NotSupported",
+	 "Function is not implemented by current engine"},
+	{PMEMKV_STATUS_INVALID_ARGUMENT, NULL, "InvalidArgument",
+	 "pmemkv_NI.InvalidArgument", "Argument to function has wrong value"},
+	{PMEMKV_STATUS_CONFIG_PARSING_ERROR, NULL, "ConfigParsingError",
+	 "pmemkv_NI.ConfigParsingError", "Processing config failed"},
+	{PMEMKV_STATUS_CONFIG_TYPE_ERROR, NULL, "ConfigTypeError",
+	 "pmemkv_NI.ConfigTypeError", "Config item has different type than expected"},
+	{PMEMKV_STATUS_STOPPED_BY_CB, NULL, "StoppedByCallback",
+	 "pmemkv_NI.StoppedByCallback", "Callback function aborted in an unexpected way"},
+	{PMEMKV_STATUS_OUT_OF_MEMORY, &PyExc_MemoryError, NULL, NULL,
+	 "Operation failed because there is not enough memory (or space on the device)"},
+	{PMEMKV_STATUS_WRONG_ENGINE_NAME, NULL, "WrongEngineName",
+	 "pmemkv_NI.WrongEngineName", "Engine name does not match any available engine"},
+	{PMEMKV_STATUS_TRANSACTION_SCOPE_ERROR, NULL, "TransactionScopeError",
+	 "pmemkv_NI.TransactionScopeError",
+	 "An error with the scope of the libpmemobj transaction. This exception is defined for compatibility with pmemkv API and probably will never occur"},
 };
 
+#define EXCEPTIONS_COUNT (sizeof(ExceptionDescriptors) / sizeof(ExceptionDescriptors[0]))
+
 static const char *memory_exception_msg = "Cannot allocate memory for internal objects";
 
+/*
+ * Per-interpreter state of the module. Nothing mutable is kept in globals,
+ * so the module may be loaded in isolated subinterpreters.
+ */
+typedef struct {
+	PyObject *pmemkv_type;
+	PyObject *value_buffer_type;
+	PyObject *error;
+	PyObject *changes_lost;
+	PyObject *exceptions[EXCEPTIONS_COUNT];
+} PmemkvModuleState;
+
+static int pmemkv_NI_exec(PyObject *m);
+static int pmemkv_NI_traverse(PyObject *m, visitproc visit, void *arg);
+static int pmemkv_NI_clear(PyObject *m);
+static void pmemkv_NI_free(void *m);
+
+static PyModuleDef_Slot pmemkv_NI_slots[] = {
+	{Py_mod_exec, (void *)pmemkv_NI_exec},
+#if PY_VERSION_HEX >= 0x030C0000
+	{Py_mod_multiple_interpreters, Py_MOD_PER_INTERPRETER_GIL_SUPPORTED},
+#endif
+#if PY_VERSION_HEX >= 0x030D0000
+	{Py_mod_gil, Py_MOD_GIL_NOT_USED},
+#endif
+	{0, NULL}};
+
+// Module definition.
+static struct PyModuleDef pmemkv_NI_module = {
+	PyModuleDef_HEAD_INIT,
+	"_pmemkv", /* name of the module */
+	NULL, /* module documentation, may be NULL */
+	sizeof(PmemkvModuleState), /* size of per-interpreter state of the module */
+	NULL, /* module methods */
+	pmemkv_NI_slots, /* multi-phase initialization slots */
+	pmemkv_NI_traverse,
+	pmemkv_NI_clear,
+	pmemkv_NI_free,
+};
+
+#if PY_VERSION_HEX < 0x030B0000
+/*
+ * Before Python 3.11 there is no way to find the module which defined
+ * a heap type, so the module is stored in the type's dictionary.
+ */
+static const char *module_attr = "__pmemkv_module__";
+#endif
+
+static PmemkvModuleState *get_module_state(PyObject *m)
+{
+	return (PmemkvModuleState *)PyModule_GetState(m);
+}
+
+static PmemkvModuleState *get_type_state(PyTypeObject *type)
+{
+#if PY_VERSION_HEX >= 0x030B0000
+	PyObject *m = PyType_GetModuleByDef(type, &pmemkv_NI_module);
+	if (m == NULL)
+		return NULL;
+#else
+	PyObject *m = PyObject_GetAttrString((PyObject *)type, module_attr);
+	if (m == NULL)
+		return NULL;
+	Py_DECREF(m); // type is the owner of the module reference
+	if (!PyModule_Check(m) || PyModule_GetDef(m) != &pmemkv_NI_module) {
+		PyErr_SetString(PyExc_TypeError, "Type is not defined by pmemkv module");
+		return NULL;
+	}
+#endif
+	return get_module_state(m);
+}
+
+static PyObject *type_from_spec(PyObject *m, PyType_Spec *spec)
+{
+#if PY_VERSION_HEX >= 0x030B0000
+	return PyType_FromModuleAndSpec(m, spec, NULL);
+#else
+	PyObject *type = PyType_FromSpec(spec);
+	if (type != NULL && PyObject_SetAttrString(type, module_attr, m) < 0)
+		Py_CLEAR(type);
+	return type;
+#endif
+}
+
+static void set_error(PmemkvModuleState *state, int status, const char *msg)
+{
+	PyObject *exception = state->error;
+	for (size_t i = 0; i < EXCEPTIONS_COUNT; i++) {
+		if (ExceptionDescriptors[i].status == status) {
+			exception = state->exceptions[i];
+			break;
+		}
+	}
+	PyErr_SetString(exception, msg);
+}
+
 typedef struct {
 	PyObject_HEAD
 	const char *value;
@@ -123,12 +223,6 @@ static int PmemkvValueBufferObject_getbuffer(PyObject *obj, Py_buffer *view, int
 	return 0;
 }
 
-static PyBufferProcs PmemkvValueBuffer_as_buffer = {
-	// this definition is only compatible with Python 3.3 and above
-	(getbufferproc)PmemkvValueBufferObject_getbuffer,
-	(releasebufferproc)0, // we do not require any special release function
-};
-
 static PyObject *PmemkvValueBuffer_new(PyTypeObject *type, PyObject *args, PyObject *kwds)
 {
 	PmemkvValueBufferObject *self =
@@ -149,28 +243,389 @@ static int PmemkvValueBuffer_init(PmemkvValueBufferObject *self)
 
 static void PmemkvValueBuffer_dealloc(PmemkvValueBufferObject *self)
 {
-	PyObject_Del(self);
+	PyTypeObject *type = Py_TYPE(self);
+	type->tp_free((PyObject *)self);
+#if PY_VERSION_HEX >= 0x03080000
+	// instances of heap types own a reference to their type
+	Py_DECREF(type);
+#endif
 }
 
 /*
  * Configuration of PmemkvValueBuffer object.
  */
-static PyTypeObject PmemkvValueBufferType = {
-	PyVarObject_HEAD_INIT(&PyType_Type, 0)
-	.tp_name = "pmemkv.pmemkv_NI",
-	.tp_basicsize = sizeof(PmemkvValueBufferObject),
-	.tp_dealloc = (destructor)PmemkvValueBuffer_dealloc,
-	.tp_as_buffer = &PmemkvValueBuffer_as_buffer,
-	.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
-	.tp_doc = "Pmemkv value type",
-	.tp_members = PmemvValueBuffer_members,
-	.tp_init = (initproc)PmemkvValueBuffer_init,
-	.tp_new = PmemkvValueBuffer_new,
+static PyType_Slot PmemkvValueBuffer_slots[] = {
+	{Py_tp_dealloc, (void *)PmemkvValueBuffer_dealloc},
+	{Py_tp_doc, (void *)"Pmemkv value type"},
+	{Py_tp_members, (void *)PmemvValueBuffer_members},
+	{Py_tp_init, (void *)PmemkvValueBuffer_init},
+	{Py_tp_new, (void *)PmemkvValueBuffer_new},
+#if PY_VERSION_HEX >= 0x03090000
+	{Py_bf_getbuffer, (void *)PmemkvValueBufferObject_getbuffer},
+#endif
+	{0, NULL}};
+
+static PyType_Spec PmemkvValueBuffer_spec = {
+	.name = "pmemkv.pmemkv_NI_ValueBuffer",
+	.basicsize = sizeof(PmemkvValueBufferObject),
+	.itemsize = 0,
+	.flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	.slots = PmemkvValueBuffer_slots,
+};
+
+static PmemkvValueBufferObject *new_value_buffer(PyTypeObject *type, const char *value,
+						 size_t length)
+{
+	PmemkvValueBufferObject *buffer =
+		(PmemkvValueBufferObject *)type->tp_alloc(type, 0);
+	if (buffer != NULL) {
+		buffer->value = value;
+		buffer->length = length;
+	}
+	return buffer;
+}
+
+// identifies side files of ChangeLog
+static const char changes_file_magic[8] = {'P', 'M', 'K', 'V', 'L', 'O', 'G', '1'};
+
+/*
+ * Bounded log of mutations (puts and removes), which lets consumers follow
+ * changes of the database without scanning it. Records are numbered with
+ * increasing sequence numbers and stored in a ring buffer of preallocated
+ * slots, so the oldest ones are overwritten once it is full.
+ *
+ * Optionally records are also appended to a side file, from which the log is
+ * restored on the next start. The file begins with a header holding the
+ * sequence number preceding its first record and ends with a close marker,
+ * if the log was closed cleanly. When the marker is missing, some records
+ * may have been lost, so the restored log starts a new epoch: sequence
+ * numbers skip to the next multiple of 2^EPOCH_BITS and no older record is
+ * available. Consumers then get ChangesLost instead of reused numbers.
+ *
+ * Failure to record a change never fails the mutation itself. A record which
+ * could not be stored leaves a gap in the buffer (reported as ChangesLost),
+ * and after a failed write the file is no longer written, so the next start
+ * begins a new epoch.
+ *
+ * Mutations are serialized by the lock together with appending their
+ * records, so the order of records matches the order of mutations. The file
+ * is written with the lock held, but with the GIL released, so the lock has
+ * to be acquired with acquire() only.
+ */
+class ChangeLog {
+public:
+	enum Op : uint8_t { PUT = 0, REMOVE = 1, CLOSE = 2 };
+
+	struct Record {
+		uint64_t seq;
+		uint8_t op;
+		std::string key;
+		std::string value;
+	};
+
+	static const unsigned EPOCH_BITS = 32;
+
+	std::mutex lock;
+
+	explicit ChangeLog(size_t capacity)
+	    : records(capacity), first_seq(1), last_seq(0), file(NULL), sync(false),
+	      closed(false)
+	{
+	}
+
+	~ChangeLog()
+	{
+		close();
+		if (file != NULL)
+			fclose(file);
+	}
+
+	/*
+	 * Restores records from the file and rewrites it, so it holds only
+	 * records which fit in the buffer. New records are appended to it and
+	 * flushed after each write, synced to the device if sync is set.
+	 * Returns false and sets errno on failure.
+	 */
+	bool open(const char *path, bool sync)
+	{
+		this->sync = sync;
+		try {
+			return restore(path) && rewrite(path);
+		} catch (std::exception &) {
+			errno = ENOMEM;
+			return false;
+		}
+	}
+
+	/*
+	 * Locks the log. Waits with the GIL released, as the holder may be
+	 * waiting for the GIL to finish writing the file.
+	 */
+	std::unique_lock<std::mutex> acquire()
+	{
+		std::unique_lock<std::mutex> guard(lock, std::try_to_lock);
+		if (!guard.owns_lock()) {
+			Py_BEGIN_ALLOW_THREADS
+			guard.lock();
+			Py_END_ALLOW_THREADS
+		}
+		return guard;
+	}
+
+	/*
+	 * Records the mutation. Returns true if the record has to be written to
+	 * the file with write() then.
+	 */
+	bool append(uint8_t op, const char *key, size_t keybytes, const char *value,
+		    size_t valuebytes)
+	{
+		uint64_t seq = last_seq + 1;
+		Record &r = records[seq % records.size()];
+		// slot is invalid until the record is stored entirely
+		r.seq = 0;
+		advance(seq);
+		try {
+			// slots are reused, so strings allocate only when they need to grow
+			r.key.assign(key, keybytes);
+			r.value.assign(value, valuebytes);
+		} catch (std::exception &) {
+			// the file would have a gap as well
+			disable_file();
+			return false;
+		}
+		r.seq = seq;
+		r.op = op;
+		closed = false;
+		return file != NULL;
+	}
+
+	// writes the last record to the file, may be called without the GIL
+	void write()
+	{
+		const Record &r = records[last_seq % records.size()];
+		if (file != NULL &&
+		    (!write_record(file, r) || fflush(file) != 0 ||
+		     (sync && fdatasync(fileno(file)) != 0)))
+			disable_file();
+	}
+
+	/*
+	 * Copies at most max records newer than since to out. Returns false if
+	 * the first of them is no longer available (or since is not a valid
+	 * sequence number of this log). Copying stops before a missing record.
+	 */
+	bool read(uint64_t since, size_t max, std::vector<Record> &out) const
+	{
+		if (since > last_seq || since + 1 < first_seq)
+			return false;
+		for (uint64_t seq = since + 1; seq <= last_seq && out.size() < max; seq++) {
+			const Record &r = records[seq % records.size()];
+			if (r.seq != seq)
+				return !out.empty();
+			out.push_back(r);
+		}
+		return true;
+	}
+
+	uint64_t last() const
+	{
+		return last_seq;
+	}
+
+	/*
+	 * Marks the log in the file as closed cleanly and syncs it, so it is
+	 * restored without starting a new epoch. Records appended later
+	 * invalidate the marker. May be called without the GIL.
+	 */
+	void close()
+	{
+		if (file == NULL || closed)
+			return;
+		Record marker = {last_seq, CLOSE, std::string(), std::string()};
+		if (!write_record(file, marker) || fflush(file) != 0 ||
+		    fsync(fileno(file)) != 0)
+			disable_file();
+		else
+			closed = true;
+	}
+
+private:
+	std::vector<Record> records;
+	uint64_t first_seq; // oldest record which may be available
+	uint64_t last_seq;
+	FILE *file;
+	bool sync;
+	bool closed;
+
+	void advance(uint64_t seq)
+	{
+		last_seq = seq;
+		if (last_seq - first_seq + 1 > records.size())
+			first_seq = last_seq - records.size() + 1;
+	}
+
+	void disable_file()
+	{
+		if (file != NULL)
+			fclose(file);
+		file = NULL;
+	}
+
+	bool restore(const char *path)
+	{
+		FILE *in = fopen(path, "rb");
+		if (in == NULL)
+			return errno == ENOENT;
+
+		long end = -1;
+		if (fseek(in, 0, SEEK_END) == 0)
+			end = ftell(in);
+		rewind(in);
+		char header[sizeof(changes_file_magic)];
+		uint64_t start;
+		if (fread(header, sizeof(header), 1, in) != 1 ||
+		    memcmp(header, changes_file_magic, sizeof(changes_file_magic)) != 0 ||
+		    fread(&start, sizeof(start), 1, in) != 1) {
+			fclose(in);
+			errno = EINVAL;
+			return false;
+		}
+
+		first_seq = start + 1;
+		last_seq = start;
+		bool clean = false;
+		Record r;
+		long pos;
+		while ((pos = ftell(in)) >= 0 && read_record(in, end, r)) {
+			if (r.op == CLOSE && r.seq == last_seq) {
+				clean = true;
+				continue;
+			}
+			// stop at a gap, which is left by a failed write
+			if ((r.op != PUT && r.op != REMOVE) || r.seq != last_seq + 1) {
+				clean = false;
+				break;
+			}
+			Record &slot = records[r.seq % records.size()];
+			slot.seq = r.seq;
+			slot.op = r.op;
+			slot.key.swap(r.key);
+			slot.value.swap(r.value);
+			advance(r.seq);
+			clean = false;
+		}
+		fclose(in);
+
+		// anything after the close marker means it was reopened later
+		if (pos != end)
+			clean = false;
+		if (!clean) {
+			last_seq = ((last_seq >> EPOCH_BITS) + 1) << EPOCH_BITS;
+			first_seq = last_seq + 1;
+		}
+		return true;
+	}
+
+	bool rewrite(const char *path)
+	{
+		std::string tmp_path = std::string(path) + ".tmp";
+		FILE *out = fopen(tmp_path.c_str(), "wb");
+		if (out == NULL)
+			return false;
+		uint64_t start = first_seq - 1;
+		bool written = fwrite(changes_file_magic, sizeof(changes_file_magic), 1, out) == 1 &&
+			fwrite(&start, sizeof(start), 1, out) == 1;
+		for (uint64_t seq = first_seq; seq <= last_seq && written; seq++)
+			written = write_record(out, records[seq % records.size()]);
+		written = written && fflush(out) == 0 && fsync(fileno(out)) == 0;
+		if (fclose(out) != 0 || !written || rename(tmp_path.c_str(), path) != 0) {
+			int err = errno;
+			unlink(tmp_path.c_str());
+			errno = err;
+			return false;
+		}
+		// otherwise the old file (with its close marker) may be back after
+		// a system crash, and its sequence numbers would be reused
+		if (!sync_dir(path))
+			return false;
+
+		file = fopen(path, "ab");
+		return file != NULL;
+	}
+
+	static bool sync_dir(const char *path)
+	{
+		std::string dir(path);
+		size_t slash = dir.rfind('/');
+		if (slash == std::string::npos)
+			dir = ".";
+		else
+			dir.resize(slash > 0 ? slash : 1);
+		int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+		if (fd < 0)
+			return false;
+		bool synced = fsync(fd) == 0;
+		int err = errno;
+		::close(fd);
+		errno = err;
+		return synced;
+	}
+
+	static bool write_record(FILE *f, const Record &r)
+	{
+		uint64_t keybytes = r.key.size();
+		uint64_t valuebytes = r.value.size();
+		return fwrite(&r.seq, sizeof(r.seq), 1, f) == 1 &&
+			fwrite(&r.op, sizeof(r.op), 1, f) == 1 &&
+			fwrite(&keybytes, sizeof(keybytes), 1, f) == 1 &&
+			fwrite(&valuebytes, sizeof(valuebytes), 1, f) == 1 &&
+			fwrite(r.key.data(), 1, keybytes, f) == keybytes &&
+			fwrite(r.value.data(), 1, valuebytes, f) == valuebytes;
+	}
+
+	// stops at the end of file or at a record which was not written entirely
+	static bool read_record(FILE *f, long end, Record &r)
+	{
+		uint64_t keybytes, valuebytes;
+		if (fread(&r.seq, sizeof(r.seq), 1, f) != 1 ||
+		    fread(&r.op, sizeof(r.op), 1, f) != 1 ||
+		    fread(&keybytes, sizeof(keybytes), 1, f) != 1 ||
+		    fread(&valuebytes, sizeof(valuebytes), 1, f) != 1)
+			return false;
+		long pos = ftell(f);
+		if (pos < 0 || pos > end)
+			return false;
+		uint64_t remaining = end - pos;
+		if (keybytes > remaining || valuebytes > remaining - keybytes)
+			return false;
+		r.key.resize(keybytes);
+		r.value.resize(valuebytes);
+		return fread(&r.key[0], 1, keybytes, f) == keybytes &&
+			fread(&r.value[0], 1, valuebytes, f) == valuebytes;
+	}
 };
 
+/*
+ * Values of PmemkvObject.users, when the db handle cannot be used.
+ * Otherwise it is the number of operations currently using the handle.
+ */
+static const long DB_STOPPED = -1;
+static const long DB_STARTING = -2;
+
 typedef struct {
 	PyObject_HEAD
 	pmemkv_db *db;
+	PmemkvModuleState *state;
+	std::atomic<long> users;
+	std::atomic<ChangeLog *> changes;
+#ifdef Py_GIL_DISABLED
+	/*
+	 * Without the GIL nothing else serializes calls to the engine, and
+	 * most of engines (e.g. vsmap) are not thread-safe. The lock is
+	 * recursive, because callbacks may call the same object again.
+	 */
+	std::recursive_mutex engine_lock;
+#endif
 } PmemkvObject;
 
 static PyMemberDef
@@ -179,9 +634,71 @@ pmemkv_NI_members[] = {
 	{NULL}
 };
 
+/*
+ * Marks the db handle as used for the lifetime of the guard, so it cannot
+ * be closed in the meantime. Callbacks may run arbitrary Python code (even
+ * stop() on the same object) and, with the GIL released or absent, other
+ * threads may call stop() concurrently. Without the GIL the guard also
+ * holds the engine lock.
+ */
+class DbGuard {
+public:
+	explicit DbGuard(PmemkvObject *obj) : obj(obj), acquired(false)
+	{
+		long users = obj->users.load();
+		do {
+			if (users < 0) {
+				set_error(obj->state, PMEMKV_STATUS_INVALID_ARGUMENT,
+					  "Database is not started");
+				return;
+			}
+		} while (!obj->users.compare_exchange_weak(users, users + 1));
+		acquired = true;
+#ifdef Py_GIL_DISABLED
+		if (!obj->engine_lock.try_lock()) {
+			// detach while waiting, so the holder may run a stop-the-world GC
+			Py_BEGIN_ALLOW_THREADS
+			obj->engine_lock.lock();
+			Py_END_ALLOW_THREADS
+		}
+#endif
+	}
+
+	~DbGuard()
+	{
+		if (!acquired)
+			return;
+#ifdef Py_GIL_DISABLED
+		obj->engine_lock.unlock();
+#endif
+		obj->users.fetch_sub(1);
+	}
+
+	explicit operator bool() const
+	{
+		return acquired;
+	}
+
+private:
+	PmemkvObject *obj;
+	bool acquired;
+};
+
 static PyObject *
 Pmemkv_new(PyTypeObject *type, PyObject *args, PyObject *kwds) {
+	PmemkvModuleState *state = get_type_state(type);
+	if (state == NULL)
+		return NULL;
 	PmemkvObject *self = (PmemkvObject *) type->tp_alloc(type, 0);
+	if (self == NULL)
+		return NULL;
+	self->db = NULL;
+	self->state = state;
+	new (&self->users) std::atomic<long>(DB_STOPPED);
+	new (&self->changes) std::atomic<ChangeLog *>(nullptr);
+#ifdef Py_GIL_DISABLED
+	new (&self->engine_lock) std::recursive_mutex();
+#endif
 	return (PyObject *) self;
 }
 
@@ -193,56 +710,97 @@ pmemkv_NI_Start(PmemkvObject *self, PyObject* args) {
 		return NULL;
 	}
 
+	long stopped = DB_STOPPED;
+	if (!self->users.compare_exchange_strong(stopped, DB_STARTING)) {
+		PyErr_SetString(self->state->error, "Database is already started");
+		return NULL;
+	}
+
 	pmemkv_config *config = pmemkv_config_new();
 	if (config == nullptr) {
+		self->users.store(DB_STOPPED);
 		// "Allocating a new pmemkv config failed"
-		PyErr_SetString(PmemkvException, pmemkv_errormsg());
+		PyErr_SetString(self->state->error, pmemkv_errormsg());
 		return NULL;
 	}
 
 	int rv = pmemkv_config_from_json(config, (const char*) json_config.buf);
 	if (rv != PMEMKV_STATUS_OK) {
 		pmemkv_config_delete(config);
+		self->users.store(DB_STOPPED);
 		// "Creating a pmemkv config from JSON string failed"
-		PyErr_SetString(ExceptionDispatcher[rv].exception,
-				pmemkv_config_from_json_errormsg());
+		set_error(self->state, rv, pmemkv_config_from_json_errormsg());
 		return NULL;
 	}
 
 	rv = pmemkv_open((const char*) engine.buf, config, &self->db);
 	if (rv != PMEMKV_STATUS_OK) {
+		self->db = NULL;
+		self->users.store(DB_STOPPED);
 		// "pmemkv_open failed"
-		PyErr_SetString(ExceptionDispatcher[rv].exception, pmemkv_errormsg());
+		set_error(self->state, rv, pmemkv_errormsg());
 		return NULL;
 	}
+	self->users.store(0);
 	Py_RETURN_NONE;
 }
 
 static PyObject *
 pmemkv_NI_Stop(PmemkvObject *self) {
-	if( self->db != NULL)
-		pmemkv_close(self->db);
+	long idle = 0;
+	if (!self->users.compare_exchange_strong(idle, DB_STOPPED)) {
+		if (idle == DB_STOPPED)
+			Py_RETURN_NONE;
+		PyErr_SetString(self->state->error,
+				"Database is in use and cannot be stopped");
+		return NULL;
+	}
+	pmemkv_close(self->db);
 	self->db = NULL;
+
+	ChangeLog *changes = self->changes.load();
+	if (changes != NULL) {
+		std::unique_lock<std::mutex> lock = changes->acquire();
+		Py_BEGIN_ALLOW_THREADS
+		changes->close();
+		Py_END_ALLOW_THREADS
+	}
 	Py_RETURN_NONE;
 }
 
 static void
 Pmemkv_dealloc(PmemkvObject *self) {
-    pmemkv_NI_Stop(self);
-    Py_TYPE(self)->tp_free((PyObject *) self);
+	// no operation can be in progress, as each of them holds a reference to self
+	if (self->db != NULL)
+		pmemkv_close(self->db);
+	self->db = NULL;
+	delete self->changes.load();
+#ifdef Py_GIL_DISABLED
+	self->engine_lock.~recursive_mutex();
+#endif
+	PyTypeObject *type = Py_TYPE(self);
+	type->tp_free((PyObject *) self);
+#if PY_VERSION_HEX >= 0x03080000
+	// instances of heap types own a reference to their type
+	Py_DECREF(type);
+#endif
 }
 
+typedef struct {
+	PyObject *callback;
+	PyTypeObject *value_buffer_type;
+} CallbackContext;
+
 void value_callback(const char *value, size_t valuebyte, void *context)
 {
+	CallbackContext *cxt = (CallbackContext *)context;
 	PmemkvValueBufferObject *entry =
-		PyObject_New(PmemkvValueBufferObject, &PmemkvValueBufferType);
+		new_value_buffer(cxt->value_buffer_type, value, valuebyte);
 	if (entry == NULL) {
 
 		PyErr_SetString(PyExc_MemoryError, memory_exception_msg);
 		return;
 	}
-	entry->value = value;
-	entry->length = valuebyte;
 	PyObject *args = PyTuple_New(1);
 	if (args == NULL) {
 		Py_DECREF(entry);
@@ -251,8 +809,11 @@ void value_callback(const char *value, size_t valuebyte, void *context)
 	}
 	// PyTuple_SetItem sets en exception on failure on its own
 	if (PyTuple_SetItem(args, 0, (PyObject *)entry) == 0) {
-		PyObject *res = PyObject_CallObject((PyObject *)context, args);
+		PyObject *res = PyObject_CallObject(cxt->callback, args);
 		Py_XDECREF(res);
+		// entry may outlive the call, but the data it points to may not
+		entry->value = NULL;
+		entry->length = 0;
 	}
 	Py_XDECREF(args); // args is the owner of the entry reference counter
 }
@@ -269,20 +830,17 @@ int key_callback(const char *key, size_t keybytes, const char *value, size_t val
 int key_value_callback(const char *key, size_t keybytes, const char *value,
 		       size_t valuebyte, void *context)
 {
+	CallbackContext *cxt = (CallbackContext *)context;
 	PmemkvValueBufferObject *value_buffer =
-		PyObject_New(PmemkvValueBufferObject, &PmemkvValueBufferType);
+		new_value_buffer(cxt->value_buffer_type, value, valuebyte);
 	PmemkvValueBufferObject *key_buffer =
-		PyObject_New(PmemkvValueBufferObject, &PmemkvValueBufferType);
+		new_value_buffer(cxt->value_buffer_type, key, keybytes);
 	if ((value_buffer == NULL) || (key_buffer == NULL)) {
 		Py_XDECREF(value_buffer);
 		Py_XDECREF(key_buffer);
 		PyErr_SetString(PyExc_MemoryError, memory_exception_msg);
 		return -1;
 	}
-	value_buffer->value = value;
-	value_buffer->length = valuebyte;
-	key_buffer->value = key;
-	key_buffer->length = keybytes;
 
 	PyObject *args = PyTuple_New(2);
 	if (args == NULL) {
@@ -293,7 +851,7 @@ int key_value_callback(const char *key, size_t keybytes, const char *value,
 	// PyTuple_SetItem sets an exception on failure on its own
 	if ((PyTuple_SetItem(args, 0, (PyObject *)key_buffer) == 0) &&
 	    (PyTuple_SetItem(args, 1, (PyObject *)value_buffer) == 0)) {
-		PyObject *res = PyObject_CallObject((PyObject *)context, args);
+		PyObject *res = PyObject_CallObject(cxt->callback, args);
 		Py_XDECREF(res);
 	}
 	key_buffer->value = NULL;
@@ -315,11 +873,16 @@ pmemkv_NI_GetKeys(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "O:set_callback", &python_callback)) {
 		return NULL;
 	}
-	int result = pmemkv_get_all(self->db, key_callback, python_callback);
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
+	int result = pmemkv_get_all(self->db, key_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -332,12 +895,17 @@ pmemkv_NI_GetKeysAbove(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*O:set_callback", &key, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_above(self->db, (const char *)key.buf, key.len,
-				      key_callback, python_callback);
+				      key_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -350,12 +918,17 @@ pmemkv_NI_GetKeysBelow(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*O:set_callback", &key, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_below(self->db, (const char *)key.buf, key.len,
-				      key_callback, python_callback);
+				      key_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -368,13 +941,18 @@ pmemkv_NI_GetKeysBetween(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*s*O:set_callback", &key1, &key2, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_between(self->db, (const char *)key1.buf, key1.len,
 					(const char *)key2.buf, key2.len, key_callback,
-					python_callback);
+					&cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -383,10 +961,13 @@ pmemkv_NI_GetKeysBetween(PmemkvObject *self, PyObject* args) {
 // "Count" Methods.
 static PyObject *
 pmemkv_NI_CountAll(PmemkvObject *self) {
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	size_t cnt;
 	int result = pmemkv_count_all(self->db, &cnt);
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return Py_BuildValue("i", cnt);
@@ -398,10 +979,13 @@ pmemkv_NI_CountAbove(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*", &key)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	size_t cnt;
 	int result = pmemkv_count_above(self->db, (const char*) key.buf, key.len, &cnt);
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return Py_BuildValue("i", cnt);
@@ -413,10 +997,13 @@ pmemkv_NI_CountBelow(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*", &key)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	size_t cnt;
 	int result = pmemkv_count_below(self->db, (const char*) key.buf, key.len, &cnt);
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return Py_BuildValue("i", cnt);
@@ -428,10 +1015,13 @@ pmemkv_NI_CountBetween(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*s*", &key1, &key2)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	size_t cnt;
 	int result = pmemkv_count_between(self->db, (const char*) key1.buf, key1.len, (const char*) key2.buf, key2.len, &cnt);
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return Py_BuildValue("i", cnt);
@@ -444,11 +1034,16 @@ pmemkv_NI_GetAll(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "O:set_callback", &python_callback)) {
 		return NULL;
 	}
-	int result = pmemkv_get_all(self->db, key_value_callback, python_callback);
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
+	int result = pmemkv_get_all(self->db, key_value_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -461,12 +1056,17 @@ pmemkv_NI_GetAbove(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*O:set_callback", &key, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_above(self->db, (const char *)key.buf, key.len,
-				      key_value_callback, python_callback);
+				      key_value_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -479,12 +1079,17 @@ pmemkv_NI_GetBelow(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*O:set_callback", &key, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_below(self->db, (const char *)key.buf, key.len,
-				      key_value_callback, python_callback);
+				      key_value_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -497,13 +1102,18 @@ pmemkv_NI_GetBetween(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*s*O:set_callback", &key1, &key2, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get_between(self->db, (const char *)key1.buf, key1.len,
 					(const char *)key2.buf, key2.len,
-					key_value_callback, python_callback);
+					key_value_callback, &cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -516,9 +1126,12 @@ pmemkv_NI_Exists(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*", &key)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	int result = pmemkv_exists(self->db, (const char*) key.buf, key.len);
 	if (result != PMEMKV_STATUS_OK && result != PMEMKV_STATUS_NOT_FOUND) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return PyBool_FromLong(result == PMEMKV_STATUS_OK);
@@ -531,9 +1144,28 @@ pmemkv_NI_Put(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*s*", &key, &value)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	ChangeLog *changes = self->changes.load();
+	std::unique_lock<std::mutex> lock;
+	if (changes != NULL)
+		lock = changes->acquire();
 	int result = pmemkv_put(self->db, (const char*) key.buf, key.len, (const char*) value.buf, value.len);
+	if (changes != NULL) {
+		if (result == PMEMKV_STATUS_OK &&
+		    changes->append(ChangeLog::PUT, (const char *)key.buf, key.len,
+				    (const char *)value.buf, value.len)) {
+			// other threads may run, while the record is being written
+			Py_BEGIN_ALLOW_THREADS
+			changes->write();
+			Py_END_ALLOW_THREADS
+		}
+		// Python API must not be called with the lock held
+		lock.unlock();
+	}
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -545,6 +1177,9 @@ static PyObject *pmemkv_NI_GetString(PmemkvObject *self, PyObject *args)
 	if (!PyArg_ParseTuple(args, "s*", &key)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
 	struct GetCallbackContext {
 		int status;
 		std::string value;
@@ -560,7 +1195,7 @@ static PyObject *pmemkv_NI_GetString(PmemkvObject *self, PyObject *args)
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	} else if (cxt.status == PMEMKV_STATUS_OK) {
 		return Py_BuildValue("s#", cxt.value.data(), cxt.value.size());
@@ -575,12 +1210,17 @@ static PyObject *pmemkv_NI_Get(PmemkvObject *self, PyObject *args)
 	if (!PyArg_ParseTuple(args, "s*O:set_callback", &key, &python_callback)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	CallbackContext cxt = {python_callback,
+			       (PyTypeObject *)self->state->value_buffer_type};
 	int result = pmemkv_get(self->db, (const char *)key.buf, key.len, value_callback,
-				python_callback);
+				&cxt);
 	if (PyErr_Occurred() != NULL)
 		return NULL;
 	if (result != PMEMKV_STATUS_OK) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -592,14 +1232,142 @@ pmemkv_NI_Remove(PmemkvObject *self, PyObject* args) {
 	if (!PyArg_ParseTuple(args, "s*", &key)) {
 		return NULL;
 	}
+	DbGuard guard(self);
+	if (!guard)
+		return NULL;
+	ChangeLog *changes = self->changes.load();
+	std::unique_lock<std::mutex> lock;
+	if (changes != NULL)
+		lock = changes->acquire();
 	int result = pmemkv_remove(self->db, (const char*) key.buf, key.len);
+	if (changes != NULL) {
+		if (result == PMEMKV_STATUS_OK &&
+		    changes->append(ChangeLog::REMOVE, (const char *)key.buf, key.len,
+				    NULL, 0)) {
+			// other threads may run, while the record is being written
+			Py_BEGIN_ALLOW_THREADS
+			changes->write();
+			Py_END_ALLOW_THREADS
+		}
+		// Python API must not be called with the lock held
+		lock.unlock();
+	}
 	if (result != PMEMKV_STATUS_OK && result != PMEMKV_STATUS_NOT_FOUND) {
-		PyErr_SetString(ExceptionDispatcher[result].exception, pmemkv_errormsg());
+		set_error(self->state, result, pmemkv_errormsg());
 		return NULL;
 	}
 	return PyBool_FromLong(result == PMEMKV_STATUS_OK);
 }
 
+// "Changes" Methods.
+static PyObject *
+pmemkv_NI_EnableChanges(PmemkvObject *self, PyObject* args) {
+	Py_ssize_t capacity;
+	const char *path;
+	int sync;
+	if (!PyArg_ParseTuple(args, "nzp", &capacity, &path, &sync)) {
+		return NULL;
+	}
+	if (capacity <= 0) {
+		PyErr_SetString(PyExc_ValueError, "Capacity of the log of changes must be positive");
+		return NULL;
+	}
+	if (self->changes.load() != NULL) {
+		PyErr_SetString(self->state->error, "Log of changes is already enabled");
+		return NULL;
+	}
+	ChangeLog *changes;
+	try {
+		changes = new ChangeLog(capacity);
+	} catch (std::exception &) {
+		PyErr_SetString(PyExc_MemoryError, memory_exception_msg);
+		return NULL;
+	}
+	bool opened = true;
+	if (path != NULL) {
+		// the log is not shared yet, so the file is restored without the GIL
+		Py_BEGIN_ALLOW_THREADS
+		opened = changes->open(path, sync);
+		Py_END_ALLOW_THREADS
+	}
+	if (!opened) {
+		delete changes;
+		return PyErr_SetFromErrnoWithFilename(PyExc_OSError, path);
+	}
+	ChangeLog *disabled = NULL;
+	if (!self->changes.compare_exchange_strong(disabled, changes)) {
+		delete changes;
+		PyErr_SetString(self->state->error, "Log of changes is already enabled");
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static PyObject *
+pmemkv_NI_GetChanges(PmemkvObject *self, PyObject* args) {
+	unsigned long long since;
+	Py_ssize_t max;
+	if (!PyArg_ParseTuple(args, "Kn", &since, &max)) {
+		return NULL;
+	}
+	ChangeLog *changes = self->changes.load();
+	if (changes == NULL) {
+		PyErr_SetString(self->state->error, "Log of changes is not enabled");
+		return NULL;
+	}
+	// records are copied out, so Python objects are created without the lock held
+	std::vector<ChangeLog::Record> batch;
+	bool available;
+	try {
+		std::unique_lock<std::mutex> lock = changes->acquire();
+		available = changes->read(since, max > 0 ? max : 0, batch);
+	} catch (std::exception &) {
+		PyErr_SetString(PyExc_MemoryError, memory_exception_msg);
+		return NULL;
+	}
+	if (!available) {
+		PyErr_Format(self->state->changes_lost,
+			     "Changes after %llu are no longer available", since);
+		return NULL;
+	}
+
+	PyObject *list = PyList_New(batch.size());
+	if (list == NULL)
+		return NULL;
+	for (size_t i = 0; i < batch.size(); i++) {
+		const ChangeLog::Record &r = batch[i];
+		PyObject *item;
+		if (r.op == ChangeLog::PUT)
+			item = Py_BuildValue("Ksy#y#", (unsigned long long)r.seq, "put",
+					     r.key.data(), (Py_ssize_t)r.key.size(),
+					     r.value.data(), (Py_ssize_t)r.value.size());
+		else
+			item = Py_BuildValue("Ksy#O", (unsigned long long)r.seq, "remove",
+					     r.key.data(), (Py_ssize_t)r.key.size(), Py_None);
+		if (item == NULL) {
+			Py_DECREF(list);
+			return NULL;
+		}
+		PyList_SET_ITEM(list, i, item);
+	}
+	return list;
+}
+
+static PyObject *
+pmemkv_NI_LastChange(PmemkvObject *self) {
+	ChangeLog *changes = self->changes.load();
+	if (changes == NULL) {
+		PyErr_SetString(self->state->error, "Log of changes is not enabled");
+		return NULL;
+	}
+	uint64_t last;
+	{
+		std::unique_lock<std::mutex> lock = changes->acquire();
+		last = changes->last();
+	}
+	return PyLong_FromUnsignedLongLong(last);
+}
+
 // Functions declarations.
 static PyMethodDef pmemkv_NI_methods[] = {
 	{"start", (PyCFunction)pmemkv_NI_Start, METH_VARARGS, NULL},
@@ -621,75 +1389,133 @@ static PyMethodDef pmemkv_NI_methods[] = {
 	{"get_between", (PyCFunction)pmemkv_NI_GetBetween, METH_VARARGS, NULL},
 	{"exists", (PyCFunction)pmemkv_NI_Exists, METH_VARARGS, NULL},
 	{"remove", (PyCFunction)pmemkv_NI_Remove, METH_VARARGS, NULL},
+	{"enable_changes", (PyCFunction)pmemkv_NI_EnableChanges, METH_VARARGS, NULL},
+	{"get_changes", (PyCFunction)pmemkv_NI_GetChanges, METH_VARARGS, NULL},
+	{"last_change", (PyCFunction)pmemkv_NI_LastChange, METH_NOARGS, NULL},
 	{NULL, NULL, 0, NULL}};
 
 /*
  * Configuration of pmemkv_NI object.
  */
-static PyTypeObject PmemkvType = {
-	PyVarObject_HEAD_INIT(NULL, 0)
-	.tp_name = "pmemkv.pmemkv_NI",
-	.tp_basicsize = sizeof(PmemkvObject),
-	.tp_dealloc = (destructor)Pmemkv_dealloc,
-	.tp_flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
-	.tp_doc = "Pmemkv binding",
-	.tp_methods = pmemkv_NI_methods,
-	.tp_members = pmemkv_NI_members,
-	.tp_new = Pmemkv_new,
-};
+static PyType_Slot Pmemkv_slots[] = {
+	{Py_tp_dealloc, (void *)Pmemkv_dealloc},
+	{Py_tp_doc, (void *)"Pmemkv binding"},
+	{Py_tp_methods, (void *)pmemkv_NI_methods},
+	{Py_tp_members, (void *)pmemkv_NI_members},
+	{Py_tp_new, (void *)Pmemkv_new},
+	{0, NULL}};
 
-// Module definition.
-static struct PyModuleDef pmemkv_NI_module = {
-	PyModuleDef_HEAD_INIT,
-	"_pmemkv", /* name of the module */
-	NULL, /* module documentation, may be NULL */
-	-1, /* size of per-interpreter state of the module, or -1 if the module keeps state in global variables. */
+static PyType_Spec Pmemkv_spec = {
+	.name = "pmemkv.pmemkv_NI",
+	.basicsize = sizeof(PmemkvObject),
+	.itemsize = 0,
+	.flags = Py_TPFLAGS_DEFAULT | Py_TPFLAGS_BASETYPE,
+	.slots = Pmemkv_slots,
 };
 
-// Creating dynamic module.
-PyMODINIT_FUNC
-PyInit__pmemkv(void) {
-	PyObject *m;
-	if (PyType_Ready(&PmemkvType) < 0)
-		return NULL;
+/*
+ * Adds object to the module. Unlike PyModule_AddObject, it does not steal
+ * the reference, so the caller remains the owner of obj.
+ */
+static int add_module_object(PyObject *m, const char *name, PyObject *obj)
+{
+	Py_INCREF(obj);
+	if (PyModule_AddObject(m, name, obj) < 0) {
+		Py_DECREF(obj);
+		return -1;
+	}
+	return 0;
+}
 
-	m = PyModule_Create(&pmemkv_NI_module);
-	if (m == NULL)
-		return NULL;
+// Executing module in each interpreter which imports it.
+static int
+pmemkv_NI_exec(PyObject *m) {
+	PmemkvModuleState *state = get_module_state(m);
 
-	try {
-		Py_INCREF(&PmemkvType);
-		if (PyModule_AddObject(m, "pmemkv_NI", (PyObject *)&PmemkvType) < 0) {
-			throw;
-		}
-		PmemkvException =
-			PyErr_NewException("pmemkv_NI.PmemkvException", NULL, NULL);
-		if (PyModule_AddObject(m, "Error", PmemkvException) < 0) {
-			throw;
-		}
-		for (auto &e : ExceptionDispatcher) {
-			if (e.second.exception == NULL) {
-				e.second.exception = PyErr_NewExceptionWithDoc(
-					e.second.exception_name, e.second.docstring,
-					PmemkvException, NULL);
-				if (PyModule_AddObject(m, e.second.object_name,
-						       e.second.exception) < 0) {
-					throw;
-				}
-			}
-		}
-	} catch (...) {
-		Py_XDECREF(&PmemkvType);
-		Py_XDECREF(m);
-		Py_XDECREF(PmemkvException);
-		Py_XDECREF(m);
-		for (auto &e : ExceptionDispatcher) {
-			Py_XDECREF(e.second.exception);
-			Py_XDECREF(m);
+	state->value_buffer_type = type_from_spec(m, &PmemkvValueBuffer_spec);
+	if (state->value_buffer_type == NULL)
+		return -1;
+#if PY_VERSION_HEX < 0x03090000
+	// buffer slots cannot be passed through the type spec before Python 3.9
+	((PyTypeObject *)state->value_buffer_type)->tp_as_buffer->bf_getbuffer =
+		(getbufferproc)PmemkvValueBufferObject_getbuffer;
+#endif
+
+	state->pmemkv_type = type_from_spec(m, &Pmemkv_spec);
+	if (state->pmemkv_type == NULL)
+		return -1;
+	if (add_module_object(m, "pmemkv_NI", state->pmemkv_type) < 0)
+		return -1;
+
+	state->error = PyErr_NewException("pmemkv_NI.PmemkvException", NULL, NULL);
+	if (state->error == NULL)
+		return -1;
+	if (add_module_object(m, "Error", state->error) < 0)
+		return -1;
+
+	state->changes_lost = PyErr_NewExceptionWithDoc(
+		"pmemkv_NI.ChangesLost",
+		"Requested changes were already dropped from the log of changes",
+		state->error, NULL);
+	if (state->changes_lost == NULL)
+		return -1;
+	if (add_module_object(m, "ChangesLost", state->changes_lost) < 0)
+		return -1;
+
+	for (size_t i = 0; i < EXCEPTIONS_COUNT; i++) {
+		const ExceptionDescriptor &e = ExceptionDescriptors[i];
+		if (e.builtin != NULL) {
+			Py_INCREF(*e.builtin);
+			state->exceptions[i] = *e.builtin;
+			continue;
 		}
-		return NULL;
+		state->exceptions[i] = PyErr_NewExceptionWithDoc(
+			e.exception_name, e.docstring, state->error, NULL);
+		if (state->exceptions[i] == NULL)
+			return -1;
+		if (add_module_object(m, e.object_name, state->exceptions[i]) < 0)
+			return -1;
 	}
-	return m;
+	return 0;
+}
+
+static int
+pmemkv_NI_traverse(PyObject *m, visitproc visit, void *arg) {
+	PmemkvModuleState *state = get_module_state(m);
+	if (state == NULL)
+		return 0;
+	Py_VISIT(state->pmemkv_type);
+	Py_VISIT(state->value_buffer_type);
+	Py_VISIT(state->error);
+	Py_VISIT(state->changes_lost);
+	for (size_t i = 0; i < EXCEPTIONS_COUNT; i++)
+		Py_VISIT(state->exceptions[i]);
+	return 0;
+}
+
+static int
+pmemkv_NI_clear(PyObject *m) {
+	PmemkvModuleState *state = get_module_state(m);
+	if (state == NULL)
+		return 0;
+	Py_CLEAR(state->pmemkv_type);
+	Py_CLEAR(state->value_buffer_type);
+	Py_CLEAR(state->error);
+	Py_CLEAR(state->changes_lost);
+	for (size_t i = 0; i < EXCEPTIONS_COUNT; i++)
+		Py_CLEAR(state->exceptions[i]);
+	return 0;
+}
+
+static void
+pmemkv_NI_free(void *m) {
+	pmemkv_NI_clear((PyObject *)m);
+}
+
+// Creating dynamic module, using multi-phase initialization.
+PyMODINIT_FUNC
+PyInit__pmemkv(void) {
+	return PyModuleDef_Init(&pmemkv_NI_module);
 }
 
 #ifdef __cplusplus
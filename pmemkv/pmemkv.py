@@ -32,6 +32,22 @@
 
 import _pmemkv
 import json
+from collections import namedtuple
+
+Change = namedtuple("Change", ["seq", "op", "key", "value"])
+Change.__doc__ = """
+Single record of the log of changes, see Database.changes().
+
+seq : int
+    Sequence number of the change. Numbers of subsequent changes are
+    consecutive, except for the start of a new epoch (see Database.changes()).
+op : str
+    Either "put" or "remove".
+key : bytes
+    Key of the changed record.
+value : bytes or None
+    Value which was put, None for "remove".
+"""
 
 class Database():
     """
@@ -51,10 +67,18 @@ class Database():
     - ConfigTypeError,
     - StoppedByCallback,
     - WrongEngineName,
-    - TransactionScopeError.
+    - TransactionScopeError,
+    - ChangesLost.
+
+    The binding may be imported in isolated subinterpreters (each with its own
+    GIL) and in free-threaded Python builds. In free-threaded builds calls on
+    a single Database are serialized by the binding, as they are by the GIL
+    otherwise. Database cannot be stopped while it is in use, e.g. from
+    inside a callback or by another thread (Error is raised then).
     """
 
-    def __init__(self, engine, config):
+    def __init__(self, engine, config, changes_capacity=0, changes_path=None,
+                 changes_sync=False):
         """
         Parameters
         ----------
@@ -65,12 +89,40 @@ class Database():
             configuration parameters are dependent on particular engine.
             For more information on engine configuration please look into
             pmemkv man pages.
+        changes_capacity : int
+            Number of the most recent changes kept in the log of changes
+            (see changes()). The log is disabled by default (0).
+        changes_path : str
+            Optional path of a file to which the log of changes is written.
+            It is restored from this file on the next start, so sequence
+            numbers are preserved across restarts. The file has to be used
+            with the same database only. Each change is passed to the
+            operating system right after it is made, so it survives a crash
+            of the process, but not of the system. stop() syncs the file to
+            the device. If the log was not stopped cleanly or writing to
+            the file failed (the file is not written any more then), a new
+            epoch is started on the next start (see changes()). Such failure
+            never fails put() or remove().
+        changes_sync : bool
+            Whether to sync the file to the device after each change, so
+            changes survive a crash of the system as well. It makes writes
+            considerably slower. Changes are written and synced without the
+            GIL, so other threads keep running, but their puts and removes
+            wait for the sync.
         """
         if not isinstance(config, dict):
             raise TypeError("Config should be dictionary")
+        if (changes_path is not None or changes_sync) and changes_capacity <= 0:
+            raise ValueError("changes_path and changes_sync require positive changes_capacity")
         self.config = json.dumps(config)
         self.db = _pmemkv.pmemkv_NI()
         self.db.start(engine, self.config)
+        if changes_capacity > 0:
+            try:
+                self.db.enable_changes(changes_capacity, changes_path, changes_sync)
+            except Exception:
+                self.db.stop()
+                raise
 
     def __setitem__(self, key, value):
         self.put(key,value)
@@ -397,3 +449,68 @@ class Database():
             removal.
         """
         return self.db.remove(key)
+
+    def changes(self, since_seq=0, batch_size=1024):
+        """
+        Iterates over changes (puts and removes) made after the given one.
+        Requires the log of changes to be enabled (see changes_capacity).
+
+        Changes are fetched from the log in batches, so memory usage is bounded
+        by batch_size. Iteration stops when there are no more changes;
+        to follow the database, call it again with the last seen sequence
+        number.
+
+        The log holds only the most recent changes, so a new consumer should
+        read last_change(), scan the whole database and then follow changes
+        made after the read sequence number.
+
+        Parameters
+        ----------
+        since_seq : int
+            Sequence number of the last change already processed, 0 to start
+            from the first change ever recorded. ChangesLost is raised for 0
+            as well, once that change is no longer in the log.
+        batch_size : int
+            Maximum number of changes fetched from the log at once.
+
+        Returns
+        -------
+        changes : iterator of Change
+            Changes in the order they were made.
+
+        Raises
+        ------
+        ChangesLost
+            If some of the requested changes were already dropped from the log
+            or could not be recorded. It is also raised for all changes made
+            before the log was restored from a file, which was not closed
+            cleanly. Sequence numbers of such restored log start a new epoch:
+            they skip to the next multiple of 2^32, so they are never reused.
+            The consumer should then rescan the whole database and continue
+            from last_change() read before the rescan.
+        """
+        if since_seq < 0:
+            raise ValueError("since_seq should not be negative")
+        if batch_size <= 0:
+            raise ValueError("batch_size should be positive")
+        return self._changes(since_seq, batch_size)
+
+    def _changes(self, since_seq, batch_size):
+        while True:
+            batch = self.db.get_changes(since_seq, batch_size)
+            for change in batch:
+                yield Change(*change)
+            if len(batch) < batch_size:
+                return
+            since_seq = batch[-1][0]
+
+    def last_change(self):
+        """
+        Returns sequence number of the most recent change in the log of changes.
+
+        Returns
+        -------
+        seq : int
+            Sequence number of the last change, 0 if there were no changes.
+        """
+        return self.db.last_change()
@@ -30,11 +30,26 @@
  * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 '''
 
+import os
+import struct
+import subprocess
+import sys
+import tempfile
+import threading
+import time
 import unittest
 
 from pmemkv import Database
 import pmemkv
 
+try:
+    import _interpreters as interpreters
+except ImportError:
+    try:
+        import _xxsubinterpreters as interpreters
+    except ImportError:
+        interpreters = None
+
 
 class TestKVEngine(unittest.TestCase):
 
@@ -254,6 +269,247 @@ class TestKVEngine(unittest.TestCase):
             db = Database(self.engine, {"path":1234, "size": 1073741824})
         self.assertEqual(db, None)
 
+    def test_throws_exception_on_use_after_stop(self):
+        db = Database(self.engine, self.config)
+        db.put(r"key1", r"value1")
+        db.stop()
+        with self.assertRaises(pmemkv.InvalidArgument):
+            db.get_string(r"key1")
+        with self.assertRaises(pmemkv.InvalidArgument):
+            db.count_all()
+
+    def test_throws_exception_on_stop_inside_callback(self):
+        db = Database(self.engine, self.config)
+        db.put(r"key1", r"value1")
+        def callback(key, value):
+            with self.assertRaises(pmemkv.Error):
+                db.stop()
+        db.get_all(callback)
+        """ Database is still usable, as it was not stopped. """
+        self.assertEqual(db.get_string(r"key1"), r"value1")
+        db.stop()
+
+    @unittest.skipIf(getattr(sys, "_is_gil_enabled", lambda: True)(),
+                     "requires free-threaded build")
+    def test_uses_database_from_many_threads(self):
+        db = Database(self.engine, self.config)
+        threads_count = 8
+        elements = 1000
+        errors = []
+
+        def put_and_get(n):
+            try:
+                for i in range(elements):
+                    key = "{}_{}".format(n, i)
+                    db.put(key, key)
+                    if db.get_string(key) != key:
+                        errors.append(key)
+            except Exception as e:
+                errors.append(e)
+
+        def put_and_stop(n):
+            try:
+                for i in range(elements):
+                    try:
+                        db.put("{}_{}".format(n, i), "value")
+                        if i % 100 == 0:
+                            db.stop()
+                    except pmemkv.Error:
+                        """ Database is in use by another thread or stopped. """
+                        pass
+            except Exception as e:
+                errors.append(e)
+
+        for target in (put_and_get, put_and_stop):
+            threads = [threading.Thread(target=target, args=(n,))
+                       for n in range(threads_count)]
+            for t in threads:
+                t.start()
+            for t in threads:
+                t.join()
+            self.assertEqual(errors, [])
+            if target is put_and_get:
+                self.assertEqual(db.count_all(), threads_count * elements)
+        db.stop()
+
+    def test_records_changes(self):
+        db = Database(self.engine, self.config, changes_capacity=10)
+        self.assertEqual(db.last_change(), 0)
+        self.assertEqual(list(db.changes()), [])
+        db.put(r"key1", r"value1")
+        db[r"key2"] = r"value2"
+        self.assertTrue(db.remove(r"key1"))
+        self.assertFalse(db.remove(r"key3"))
+        del db[r"key2"]
+        self.assertEqual(db.last_change(), 4)
+        self.assertEqual(list(db.changes()), [
+            (1, "put", b"key1", b"value1"),
+            (2, "put", b"key2", b"value2"),
+            (3, "remove", b"key1", None),
+            (4, "remove", b"key2", None)])
+        changes = list(db.changes(2, batch_size=1))
+        self.assertEqual([c.seq for c in changes], [3, 4])
+        self.assertEqual(changes[0].op, "remove")
+        self.assertEqual(list(db.changes(4)), [])
+        db.stop()
+
+    def test_throws_exception_when_changes_are_lost(self):
+        db = Database(self.engine, self.config, changes_capacity=2)
+        for i in range(5):
+            db.put(str(i), str(i))
+        self.assertEqual([c.seq for c in db.changes(3)], [4, 5])
+        with self.assertRaises(pmemkv.ChangesLost):
+            list(db.changes())
+        with self.assertRaises(pmemkv.Error):
+            list(db.changes(2))
+        with self.assertRaises(pmemkv.ChangesLost):
+            list(db.changes(6))
+        db.stop()
+
+    def test_throws_exception_when_changes_are_disabled(self):
+        db = Database(self.engine, self.config)
+        db.put(r"key1", r"value1")
+        with self.assertRaises(pmemkv.Error):
+            list(db.changes())
+        db.stop()
+
+    def test_records_changes_from_many_threads(self):
+        threads_count = 4
+        elements = 100
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with Database(self.engine, self.config,
+                          changes_capacity=threads_count * elements,
+                          changes_path=path, changes_sync=True) as db:
+                def put(thread):
+                    for i in range(elements):
+                        db.put("{}_{}".format(thread, i), "v")
+                        db.last_change()
+                threads = [threading.Thread(target=put, args=(t,))
+                           for t in range(threads_count)]
+                for t in threads:
+                    t.start()
+                for t in threads:
+                    t.join()
+                changes = list(db.changes())
+            self.assertEqual([c.seq for c in changes],
+                             list(range(1, threads_count * elements + 1)))
+            with Database(self.engine, self.config,
+                          changes_capacity=threads_count * elements,
+                          changes_path=path) as db:
+                self.assertEqual(list(db.changes()), changes)
+
+    def test_throws_exception_on_invalid_changes_arguments(self):
+        db = Database(self.engine, self.config, changes_capacity=10)
+        with self.assertRaises(ValueError):
+            db.changes(-5)
+        with self.assertRaises(ValueError):
+            db.changes(0, batch_size=0)
+        db.stop()
+
+    def test_persists_changes(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with Database(self.engine, self.config, changes_capacity=3,
+                          changes_path=path) as db:
+                for i in range(5):
+                    db.put(str(i), "A\0B")
+                db.remove(r"0")
+            with Database(self.engine, self.config, changes_capacity=3,
+                          changes_path=path, changes_sync=True) as db:
+                self.assertEqual(db.last_change(), 6)
+                self.assertEqual(list(db.changes(3)), [
+                    (4, "put", b"3", b"A\0B"),
+                    (5, "put", b"4", b"A\0B"),
+                    (6, "remove", b"0", None)])
+                db.put(r"key1", r"value1")
+                self.assertEqual(list(db.changes(4)), [
+                    (5, "put", b"4", b"A\0B"),
+                    (6, "remove", b"0", None),
+                    (7, "put", b"key1", b"value1")])
+
+    def assert_new_epoch(self, db, old_seq):
+        """ Log restored after unclean shutdown never reuses sequence numbers. """
+        seq = db.last_change()
+        self.assertGreaterEqual(seq, 2**32)
+        for since in (0, old_seq - 1, old_seq, old_seq + 1):
+            with self.assertRaises(pmemkv.ChangesLost):
+                list(db.changes(since))
+        self.assertEqual(list(db.changes(seq)), [])
+        db.put(r"key1", r"value1")
+        self.assertEqual(list(db.changes(seq)),
+                         [(seq + 1, "put", b"key1", b"value1")])
+
+    def test_starts_new_epoch_after_unclean_exit(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            code = """
+import os
+import pmemkv
+db = pmemkv.Database({!r}, {!r}, changes_capacity=100, changes_path={!r})
+for i in range(50):
+    db.put(str(i), str(i))
+os._exit(0)
+""".format(self.engine, self.config, path)
+            subprocess.check_call([sys.executable, "-c", code])
+            with Database(self.engine, self.config, changes_capacity=100,
+                          changes_path=path) as db:
+                self.assert_new_epoch(db, 50)
+
+    def test_starts_new_epoch_after_torn_record(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with Database(self.engine, self.config, changes_capacity=10,
+                          changes_path=path) as db:
+                for i in range(5):
+                    db.put(str(i), str(i))
+            """ Cut off the close marker (25 bytes) and a part of the last
+                record.
+            """
+            with open(path, "r+b") as f:
+                f.truncate(os.path.getsize(path) - 25 - 3)
+            with Database(self.engine, self.config, changes_capacity=10,
+                          changes_path=path) as db:
+                self.assert_new_epoch(db, 5)
+
+    def test_starts_new_epoch_after_corrupted_record(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with Database(self.engine, self.config, changes_capacity=10,
+                          changes_path=path) as db:
+                db.put(r"key1", r"value1")
+            """ Record with lengths exceeding size of the file. """
+            with open(path, "ab") as f:
+                f.write(struct.pack("=QBQQ", 2, 0, 2**64 - 1, 2) + b"ab")
+            with Database(self.engine, self.config, changes_capacity=10,
+                          changes_path=path) as db:
+                self.assert_new_epoch(db, 1)
+
+    def test_throws_exception_on_invalid_changes_file(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with open(path, "wb") as f:
+                f.write(b"not a log")
+            with self.assertRaises(OSError):
+                Database(self.engine, self.config, changes_capacity=10,
+                         changes_path=path)
+
+    def test_compacts_changes_file(self):
+        with tempfile.TemporaryDirectory() as tmp:
+            path = os.path.join(tmp, "changes")
+            with Database(self.engine, self.config, changes_capacity=10,
+                          changes_path=path) as db:
+                for i in range(10):
+                    db.put(str(i), "v")
+            with Database(self.engine, self.config, changes_capacity=3,
+                          changes_path=path) as db:
+                self.assertEqual(db.last_change(), 10)
+                self.assertEqual([c.seq for c in db.changes(7)], [8, 9, 10])
+                """ 16 bytes of file header and 25 bytes of header with
+                    one-byte key and value for each record.
+                """
+                self.assertEqual(os.path.getsize(path), 16 + 3 * (25 + 2))
+
     def test_uses_get_keys(self):
         db = Database(self.engine, self.config)
         db.put(r"1", r"one")
@@ -622,5 +878,86 @@ class TestKVEngine(unittest.TestCase):
                 db[key] = val
                 db.get(key, callback)
 
+
+@unittest.skipIf(interpreters is None, "subinterpreters are not available")
+class TestSubinterpreters(unittest.TestCase):
+
+    def __init__(self, *args, **kwargs):
+        super().__init__(*args, **kwargs)
+        self.engine = r"vsmap"
+        self.config = {"path":"/dev/shm", "size":1073741824}
+        self.workers = 4
+
+    def run_in_subinterpreter(self, code):
+        interp = interpreters.create()
+        try:
+            failure = interpreters.run_string(interp, code)
+        finally:
+            interpreters.destroy(interp)
+        """ Since Python 3.13 failure is returned instead of being raised. """
+        if failure is not None:
+            self.fail(failure)
+
+    def worker_code(self, elements):
+        return """
+import pmemkv
+with pmemkv.Database({!r}, {!r}) as db:
+    for i in range({}):
+        db[str(i)] = str(i)
+    assert len(db) == {}
+""".format(self.engine, self.config, elements, elements)
+
+    def run_concurrently(self, code):
+        errors = []
+        def run():
+            try:
+                self.run_in_subinterpreter(code)
+            except BaseException as e:
+                errors.append(e)
+        threads = [threading.Thread(target=run) for _ in range(self.workers)]
+        for t in threads:
+            t.start()
+        for t in threads:
+            t.join()
+        self.assertEqual(errors, [])
+
+    def test_loads_module_in_subinterpreters(self):
+        self.run_in_subinterpreter("""
+import pmemkv
+assert issubclass(pmemkv.InvalidArgument, pmemkv.Error)
+with pmemkv.Database({!r}, {!r}) as db:
+    db["key1"] = "value1"
+    try:
+        db.get_string("key2")
+    except KeyError:
+        pass
+""".format(self.engine, self.config))
+        """ Module in main interpreter is still usable. """
+        with Database(self.engine, self.config) as db:
+            db["key1"] = "value1"
+            self.assertEqual(db["key1"], "value1")
+
+    def test_runs_subinterpreters_concurrently(self):
+        self.run_concurrently(self.worker_code(1000))
+
+    @unittest.skipUnless(os.environ.get("PMEMKV_BENCHMARKS"),
+                         "benchmark, set PMEMKV_BENCHMARKS=1 to run")
+    @unittest.skipIf(sys.version_info < (3, 12), "requires per-interpreter GIL")
+    @unittest.skipIf((os.cpu_count() or 1) < 2, "requires at least 2 CPUs")
+    def test_subinterpreters_scale(self):
+        code = self.worker_code(100000)
+
+        start = time.monotonic()
+        for _ in range(self.workers):
+            self.run_in_subinterpreter(code)
+        serial = time.monotonic() - start
+
+        start = time.monotonic()
+        self.run_concurrently(code)
+        parallel = time.monotonic() - start
+
+        """ Each subinterpreter has its own GIL, so workers run in parallel. """
+        self.assertLess(parallel, serial * 0.75)
+
 if __name__ == '__main__':
     unittest.main()